@@ -0,0 +1,18 @@
+#!/bin/bash
+# Compares announce connections/sec between the tracker's thread-per-connection and epoll models.
+# Usage: ./bench/connect_bench.sh [port] [seconds]   (run from the top of the repo, after `make bench`)
+PORT=${1:-6969}
+SECONDS_PER_RUN=${2:-5}
+
+for MODE in threads epoll; do
+	for IDLE in 0 500; do
+		./bin/tracker -m $MODE $PORT > /dev/null &
+		TRACKER=$!
+		sleep 0.5
+		echo -n "mode=$MODE "
+		./bin/tracker_connect_bench localhost $PORT -c 16 -d $SECONDS_PER_RUN -i $IDLE
+		kill $TRACKER
+		wait $TRACKER 2>/dev/null
+		PORT=$((PORT + 1))
+	done
+done
@@ -0,0 +1,193 @@
+/**
+* @File tracker_connect_bench.c
+* CS 470 Final Project
+* Measures how many one-shot announce connections per second a tracker can serve.
+* Worker threads connect, send one NEEDY, wait for the answer and hang up, as fast as they can.
+* Optionally parks a pile of idle connections on the tracker first, to show what slow clients cost it.
+* Usage: ./tracker_connect_bench <host> <port> [-c workers] [-d seconds] [-i idle_connections]
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "../lib/random.c"
+
+#define true 1
+#define false 0
+
+struct sockaddr_storage tracker_addr; // Resolved once, so we time the tracker and not the resolver
+socklen_t tracker_addr_len;
+volatile int running = true;
+
+typedef struct {
+	pthread_t thread_id;
+	int index;
+	long completed; // Connections that got a full answer
+	long failed; // Connections that were refused, reset, or answered with nothing
+} bench_worker;
+
+/**
+* bench_connect
+* @return  a connected socket, or -1
+*/
+int bench_connect()
+{
+	int sockfd = socket(tracker_addr.ss_family, SOCK_STREAM, 0);
+	if(sockfd == -1)
+		return -1;
+	// A tracker that never answers counts as a failure, not a hang
+	struct timeval timeout = { 2, 0 };
+	setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+	if(connect(sockfd, (struct sockaddr*)&tracker_addr, tracker_addr_len) == -1)
+	{
+		close(sockfd);
+		return -1;
+	}
+	return sockfd;
+}
+
+/**
+* bench_worker_run
+* @param  worker_in  pointer to this thread's bench_worker
+*/
+void* bench_worker_run(void* worker_in)
+{
+	bench_worker* me = (bench_worker*)worker_in;
+	char request[128];
+	char response[2048];
+	int request_length = sprintf(request, "NEEDY/10.%d.0.1:6000/bench_swarm_%d", me->index, me->index % 16) + 1;
+
+	while(running)
+	{
+		int sockfd = bench_connect();
+		if(sockfd == -1)
+		{
+			me->failed++;
+			continue;
+		}
+
+		int got_answer = false;
+		if(write(sockfd, request, request_length) == request_length)
+		{
+			// Read until the terminator or until the tracker hangs up
+			int chars_read;
+			while((chars_read = read(sockfd, response, sizeof(response))) > 0)
+			{
+				got_answer = true;
+				if(memchr(response, '\0', chars_read) != NULL)
+					break;
+			}
+		}
+		close(sockfd);
+
+		if(got_answer)
+			me->completed++;
+		else
+			me->failed++;
+	}
+	return 0;
+}
+
+/**
+* Main
+* @param  argc	number of arguments
+* @param  argv	array of arguments
+* @return 	boolean success or failure
+*/
+int main(int argc, char* argv[])
+{
+	int num_workers = 8;
+	int seconds = 5;
+	int idle_connections = 0;
+	int option;
+	int i;
+
+	while((option = getopt(argc, argv, "c:d:i:")) != -1)
+	{
+		if(option == 'c')
+			num_workers = str_to_int(optarg);
+		else if(option == 'd')
+			seconds = str_to_int(optarg);
+		else if(option == 'i')
+			idle_connections = str_to_int(optarg);
+		else
+			optind = argc + 1;
+	}
+	if(optind != argc - 2 || num_workers < 1 || seconds < 1)
+	{
+		printf("Usage: ./tracker_connect_bench <host> <port> [-c workers] [-d seconds] [-i idle_connections]\n");
+		return -1;
+	}
+
+	struct addrinfo hints, *result;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_STREAM;
+	if(getaddrinfo(argv[optind], argv[optind + 1], &hints, &result) != 0)
+	{
+		printf("Could not resolve %s\n", argv[optind]);
+		return -1;
+	}
+	memcpy(&tracker_addr, result->ai_addr, result->ai_addrlen);
+	tracker_addr_len = result->ai_addrlen;
+	freeaddrinfo(result);
+
+	struct rlimit fd_limit;
+	if(getrlimit(RLIMIT_NOFILE, &fd_limit) == 0)
+	{
+		fd_limit.rlim_cur = fd_limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &fd_limit);
+	}
+
+	// Park the idle connections first. They never send anything, just like a stalled client.
+	int* idle = malloc(sizeof(int) * (idle_connections + 1));
+	int idle_open = 0;
+	for(i = 0; i < idle_connections; i++)
+	{
+		idle[i] = bench_connect();
+		if(idle[i] != -1)
+			idle_open++;
+	}
+
+	bench_worker* workers = calloc(num_workers, sizeof(bench_worker));
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i = 0; i < num_workers; i++)
+	{
+		workers[i].index = i;
+		pthread_create(&workers[i].thread_id, NULL, bench_worker_run, (void*)&workers[i]);
+	}
+
+	sleep(seconds);
+	running = false;
+
+	long completed = 0, failed = 0;
+	for(i = 0; i < num_workers; i++)
+	{
+		pthread_join(workers[i].thread_id, NULL);
+		completed += workers[i].completed;
+		failed += workers[i].failed;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	printf("workers=%d idle=%d/%d seconds=%.2f completed=%ld failed=%ld connections/sec=%.0f\n",
+		num_workers, idle_open, idle_connections, elapsed, completed, failed, completed / elapsed);
+
+	for(i = 0; i < idle_connections; i++)
+		if(idle[i] != -1)
+			close(idle[i]);
+	free(idle);
+	free(workers);
+	return 0;
+}
@@ -23,6 +23,7 @@
 #include "../lib/hash_table.c"
 #include "../lib/linked_list.c"
 #include "../lib/network_library.c"
+#include "../lib/tracker_connection.c"
 
 // Make my syntax checker leave me alone.
 extern char *strdup(const char *s);
@@ -709,7 +710,21 @@ int parse_tracker_response(char* responseBuffer, int* numSeeders, char*** seeder
   return FALSE;
 }
 
-int broadcast_file_to_tracker(char* fileName, char* trackerName, int trackerPort)
+int check_seed_response(char* trackerResponseStr, char* fileName)
+{
+  if(strstr(trackerResponseStr, "SUCCESS") == NULL)
+  {
+    printf("Tracker sent an invalid response to our seed request for %s.\n", fileName);
+  }
+  else
+  {
+    printf("Now Seeding %s\n", fileName);
+    return TRUE;
+  }
+  return FALSE;
+}
+
+int broadcast_file_to_tracker(trackerConnection* tracker, char* fileName)
 {
   char trackerRequestStr[512];
   char trackerResponseStr[512];
@@ -718,27 +733,13 @@ int broadcast_file_to_tracker(char* fileName, char* trackerName, int trackerPort
   memset(trackerRequestStr, '\0', sizeof(trackerRequestStr));
   sprintf(trackerRequestStr, "INIT/%s:%i/%s", myHostName, myPort, fileName);
 
-  int connfd = tcp_connect(trackerName, trackerPort);
-  if(connfd == -1)
+  if(trackerConnection_request(tracker, trackerRequestStr, trackerResponseStr, sizeof(trackerResponseStr)) == -1)
   {
     printf("failed to connect to the tracker.\n");
     return FALSE;
   }
 
-  write(connfd, trackerRequestStr, strlen(trackerRequestStr));
-  read(connfd, trackerResponseStr, (sizeof(trackerResponseStr) - 1) );
-  close(connfd);
-
-  if(strstr(trackerResponseStr, "SUCCESS") == NULL)
-  {
-    printf("Tracker sent an invalid response to our seed request for %s.\n", fileName);
-  }
-  else
-  {
-    printf("Now Seeding %s\n", fileName);
-    return TRUE;
-  }
-  return FALSE;
+  return check_seed_response(trackerResponseStr, fileName);
 }
 
 void* download_manager_thread(void* arg)
@@ -750,7 +751,7 @@ void* download_manager_thread(void* arg)
   pthread_cond_init(&threadPoolCondition, NULL);
   nextThreadPoolID = 0;
 
-  int connfd;
+  trackerConnection* tracker;
   int threadsToAdd;
   char** targetClientName;
   int* targetClientPort;
@@ -758,6 +759,9 @@ void* download_manager_thread(void* arg)
   char trackerRequestStr[512];
   char trackerResponseStr[512];
 
+  // One connection to the tracker carries every request we make for this torrent
+  tracker = trackerConnection_open(curTorrent->trackerName, curTorrent->trackerPort);
+
   // While we still have parts to download. _ts = thread-safe check
   while(linkedList_isEmptyList_ts(curTorrent->downloadQueue) == FALSE)
   {
@@ -777,10 +781,7 @@ void* download_manager_thread(void* arg)
         sprintf(trackerRequestStr, "NEEDY/%s:%i/%s", myHostName, myPort, curTorrent->fileName);
       }
       //Ask the tracker for some seeders
-      connfd = tcp_connect(curTorrent->trackerName, curTorrent->trackerPort);
-      write(connfd, trackerRequestStr, strlen(trackerRequestStr));
-      read(connfd, trackerResponseStr, sizeof(trackerResponseStr));
-      close(connfd);
+      trackerConnection_request(tracker, trackerRequestStr, trackerResponseStr, sizeof(trackerResponseStr));
       parse_tracker_response(trackerResponseStr, &threadsToAdd, &targetClientName, &targetClientPort);    
 
       //spin off a thread for each seeder
@@ -817,15 +818,14 @@ void* download_manager_thread(void* arg)
   // Tell the tracker we are done
   memset(trackerRequestStr, '\0', sizeof(trackerRequestStr));
   sprintf(trackerRequestStr, "STOPPED/%s:%i", myHostName, myPort);
-  connfd = tcp_connect(curTorrent->trackerName, curTorrent->trackerPort);
-  write(connfd, trackerRequestStr, strlen(trackerRequestStr));
-  close(connfd);
+  trackerConnection_request(tracker, trackerRequestStr, trackerResponseStr, sizeof(trackerResponseStr));
 
   assemble_torrent_segments(curTorrent);
   printf("%s Has finished Downloading!\n\n", curTorrent->fileName);
 
   // Become a seeder
-  broadcast_file_to_tracker(curTorrent->fileName, curTorrent->trackerName, curTorrent->trackerPort);
+  broadcast_file_to_tracker(tracker, curTorrent->fileName);
+  trackerConnection_close(tracker);
 
   pthread_exit(NULL);
 }
@@ -834,19 +834,51 @@ void broadcast_finished_files(char* trackerName, int trackerPort)
 {
   DIR *dirPtr;
   struct dirent *curFile;
+  trackerConnection* tracker;
+  char trackerRequestStr[512];
+  char trackerResponseStr[512];
+  // Names of the files whose INIT is on the wire but not answered yet
+  char pendingFiles[TRACKER_PIPELINE_WINDOW][256];
+  int numPending = 0;
+  int i;
+
   dirPtr = opendir ("./done");
 
   if (dirPtr != NULL)
   {
+    tracker = trackerConnection_open(trackerName, trackerPort);
     curFile = readdir(dirPtr);
     while (curFile != NULL)
     {
       if( strcspn(curFile->d_name, ".") > 0 )
       {
-        broadcast_file_to_tracker(curFile->d_name, trackerName, trackerPort);
+        // Pipeline the INITs: write a window of them, then read the window of answers back
+        sprintf(trackerRequestStr, "INIT/%s:%i/%s", myHostName, myPort, curFile->d_name);
+        if(!trackerConnection_send(tracker, trackerRequestStr))
+        {
+          printf("failed to connect to the tracker.\n");
+          break;
+        }
+        strcpy(pendingFiles[numPending], curFile->d_name);
+        numPending++;
       }
       curFile = readdir(dirPtr);
+
+      if(numPending == TRACKER_PIPELINE_WINDOW || (curFile == NULL && numPending > 0))
+      {
+        for(i = 0; i < numPending; i++)
+        {
+          if(trackerConnection_receive(tracker, trackerResponseStr, sizeof(trackerResponseStr)) == -1)
+          {
+            printf("Lost the tracker connection while seeding %s.\n", pendingFiles[i]);
+            break;
+          }
+          check_seed_response(trackerResponseStr, pendingFiles[i]);
+        }
+        numPending = 0;
+      }
     }
+    trackerConnection_close(tracker);
     (void) closedir (dirPtr);
   }
   else
@@ -0,0 +1,98 @@
+/**
+* @File bounded_queue.c
+* CS 470 Final Project
+* Implements a fixed capacity FIFO of pointers for handing work between threads.
+* Producers block while the queue is full and consumers block while it is empty, so a burst of work
+* turns into backpressure on the producer instead of unbounded memory growth.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+typedef struct
+{
+  void** items; // Ring buffer of queued pointers
+  unsigned int capacity;
+  unsigned int head; // Next item to pop
+  unsigned int count; // Number of items in the queue
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+} boundedQueue;
+
+/**
+* Creates a new bounded queue
+* @param capacity the most items the queue will hold before producers have to wait
+* @return a pointer to a valid boundedQueue struct for use with the other boundedQueue functions.
+*/
+boundedQueue* boundedQueue_create(unsigned int capacity)
+{
+  boundedQueue* newQueue;
+
+  newQueue = malloc(sizeof(boundedQueue));
+  if(newQueue == NULL) { printf("Error allocating memory for boundedQueue"); exit(1); }
+
+  newQueue->items = malloc(sizeof(void*) * capacity);
+  if(newQueue->items == NULL) { printf("Error allocating memory for boundedQueue"); exit(1); }
+
+  newQueue->capacity = capacity;
+  newQueue->head = 0;
+  newQueue->count = 0;
+  pthread_mutex_init(&newQueue->lock, NULL);
+  pthread_cond_init(&newQueue->not_empty, NULL);
+  pthread_cond_init(&newQueue->not_full, NULL);
+
+  return newQueue;
+}
+
+/**
+* Adds an item to the back of the queue, waiting for room if the queue is full.
+* @param cur_queue a boundedQueue struct
+* @param item the pointer to queue
+*/
+void boundedQueue_push(boundedQueue* cur_queue, void* item)
+{
+  pthread_mutex_lock(&cur_queue->lock);
+  while(cur_queue->count == cur_queue->capacity)
+  {
+    pthread_cond_wait(&cur_queue->not_full, &cur_queue->lock);
+  }
+  cur_queue->items[(cur_queue->head + cur_queue->count) % cur_queue->capacity] = item;
+  cur_queue->count++;
+  pthread_cond_signal(&cur_queue->not_empty);
+  pthread_mutex_unlock(&cur_queue->lock);
+}
+
+/**
+* Takes the item at the front of the queue, waiting for one if the queue is empty.
+* @param cur_queue a boundedQueue struct
+* @return the oldest queued pointer
+*/
+void* boundedQueue_pop(boundedQueue* cur_queue)
+{
+  pthread_mutex_lock(&cur_queue->lock);
+  while(cur_queue->count == 0)
+  {
+    pthread_cond_wait(&cur_queue->not_empty, &cur_queue->lock);
+  }
+  void* retVal = cur_queue->items[cur_queue->head];
+  cur_queue->head = (cur_queue->head + 1) % cur_queue->capacity;
+  cur_queue->count--;
+  pthread_cond_signal(&cur_queue->not_full);
+  pthread_mutex_unlock(&cur_queue->lock);
+  return retVal;
+}
+
+/**
+* Cleans up a boundedQueue. Anything still queued is dropped, not freed.
+* @param cur_queue A pointer to the boundedQueue to be destroyed
+*/
+void boundedQueue_free(boundedQueue* cur_queue)
+{
+  pthread_mutex_destroy(&cur_queue->lock);
+  pthread_cond_destroy(&cur_queue->not_empty);
+  pthread_cond_destroy(&cur_queue->not_full);
+  free(cur_queue->items);
+  free(cur_queue);
+}
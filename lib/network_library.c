@@ -18,6 +18,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <time.h>
+#include <fcntl.h>
 
 //so my syntax checker doesn't bother me with false positives
 extern FILE *popen();
@@ -131,6 +132,9 @@ int tcp_listen(int port)
   serv_addr.sin_port = htons(port);
 
   listenfd = socket(AF_INET, SOCK_STREAM, 0);
+  // Let a restarted server rebind right away instead of waiting out old connections in TIME_WAIT
+  int reuse = 1;
+  setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
   if( (bind(listenfd, (struct sockaddr*)&serv_addr, sizeof(serv_addr))) < 0)
   {
     printf("Unable to bind to port: %d\n", port);
@@ -142,3 +146,13 @@ int tcp_listen(int port)
 
   return listenfd;
 }
+
+int set_nonblocking(int sockfd)
+{
+  int flags = fcntl(sockfd, F_GETFL, 0);
+  if(flags == -1)
+  {
+    return -1;
+  }
+  return fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
+}
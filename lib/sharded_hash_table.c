@@ -0,0 +1,250 @@
+/**
+* @File sharded_hash_table.c
+* CS 470 Final Project
+* Implements a sharded, resizable hash index keyed by arbitrary byte strings.
+* The table is split into a power of two number of shards, each with its own lock and its own bucket array,
+* so that operations on keys that land in different shards never contend with each other.
+* The table is intrusive: callers embed a shardedHashEntry as the FIRST member of their own struct,
+* and supply a function to compare a stored entry against a key.
+* NOTE: None of the lookup/insert/remove functions take the shard lock themselves. Lock the shard first
+* with shardedHashTable_lock(), do the work, then shardedHashTable_unlock().
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+// Grow a shard's bucket array once it holds this many entries per bucket on average.
+#define SHARDED_HASH_MAX_LOAD 1
+
+typedef struct shardedHashEntry
+{
+  struct shardedHashEntry* next; // Next entry in the same bucket
+  unsigned int hash; // Cached full hash of the key, so resizing never has to look at the key again
+} shardedHashEntry;
+
+//function pointer used to compare a stored entry against a key.
+typedef int (*sharded_key_match_function)(shardedHashEntry*, const void*, size_t);
+
+typedef struct
+{
+  pthread_mutex_t lock;
+  shardedHashEntry** buckets;
+  unsigned int num_buckets; // Always a power of two
+  unsigned int num_entries;
+} __attribute__((aligned(64))) hashShard; // One shard per cache line, so shard locks don't false-share
+
+typedef struct
+{
+  unsigned int num_shards; // Always a power of two
+  unsigned int shard_shift; // The top bits of the hash pick the shard, the bottom bits pick the bucket
+  hashShard* shards;
+  sharded_key_match_function match;
+} shardedHashTable;
+
+/**
+* Rounds a number up to the next power of two
+* @param n the number to round
+* @return the smallest power of two >= n
+*/
+unsigned int shardedHashTable_pow2(unsigned int n)
+{
+  unsigned int p = 1;
+  while(p < n) { p <<= 1; }
+  return p;
+}
+
+/**
+* Creates a new sharded Hash Table
+* @param num_shards the number of independently locked shards. Rounded up to a power of two.
+* @param initial_buckets the starting number of buckets in each shard. Rounded up to a power of two.
+* @param match_function a function pointer that returns true if a stored entry matches a key.
+* @return a pointer to a valid shardedHashTable struct for use with the other shardedHashTable functions.
+*/
+shardedHashTable* shardedHashTable_create(unsigned int num_shards, unsigned int initial_buckets, sharded_key_match_function match_function)
+{
+  shardedHashTable* newTable;
+  unsigned int i;
+
+  num_shards = shardedHashTable_pow2(num_shards < 1 ? 1 : num_shards);
+  initial_buckets = shardedHashTable_pow2(initial_buckets < 1 ? 1 : initial_buckets);
+
+  newTable = malloc(sizeof(shardedHashTable));
+  if(newTable == NULL) { printf("Error allocating memory for shardedHashTable"); exit(1); }
+
+  if(posix_memalign((void**)&newTable->shards, 64, sizeof(hashShard) * num_shards) != 0) { printf("Error allocating memory for shardedHashTable"); exit(1); }
+
+  newTable->num_shards = num_shards;
+  newTable->match = match_function;
+  newTable->shard_shift = 32;
+  for(i = num_shards; i > 1; i >>= 1) { newTable->shard_shift--; }
+
+  for(i = 0; i < num_shards; i++)
+  {
+    hashShard* shard = &newTable->shards[i];
+    pthread_mutex_init(&shard->lock, NULL);
+    shard->buckets = calloc(initial_buckets, sizeof(shardedHashEntry*));
+    if(shard->buckets == NULL) { printf("Error allocating memory for shardedHashTable"); exit(1); }
+    shard->num_buckets = initial_buckets;
+    shard->num_entries = 0;
+  }
+
+  return newTable;
+}
+
+/**
+* Cleans up a shardedHashTable data structure. The entries themselves belong to the caller and are not freed.
+* @param cur_table A pointer to the shardedHashTable to be destroyed
+*/
+void shardedHashTable_free(shardedHashTable* cur_table)
+{
+  unsigned int i;
+  for(i = 0; i < cur_table->num_shards; i++)
+  {
+    pthread_mutex_destroy(&cur_table->shards[i].lock);
+    free(cur_table->shards[i].buckets);
+  }
+  free(cur_table->shards);
+  free(cur_table);
+}
+
+/**
+* Generates the hash of a key
+* @param key pointer to the key bytes
+* @param key_len number of bytes in the key
+* @return a 32 bit hash of the key
+*/
+unsigned int shardedHashTable_hash(const void* key, size_t key_len)
+{
+  // FNV-1a. Cheap, and it mixes well enough that both the top and bottom bits are usable.
+  const unsigned char* bytes = (const unsigned char*)key;
+  unsigned int hashAddress = 2166136261u;
+  size_t i;
+  for(i = 0; i < key_len; i++)
+  {
+    hashAddress ^= bytes[i];
+    hashAddress *= 16777619u;
+  }
+  return hashAddress;
+}
+
+/**
+* Finds the shard responsible for a hash
+* @param cur_table a shardedHashTable struct
+* @param hash a hash generated by shardedHashTable_hash()
+* @return the shard that owns that hash
+*/
+hashShard* shardedHashTable_shard(shardedHashTable* cur_table, unsigned int hash)
+{
+  if(cur_table->num_shards == 1) { return &cur_table->shards[0]; }
+  return &cur_table->shards[hash >> cur_table->shard_shift];
+}
+
+void shardedHashTable_lock(hashShard* shard)
+{
+  pthread_mutex_lock(&shard->lock);
+}
+
+void shardedHashTable_unlock(hashShard* shard)
+{
+  pthread_mutex_unlock(&shard->lock);
+}
+
+/**
+* Looks up an entry in a shard. The caller must hold the shard lock.
+* @param cur_table a shardedHashTable struct
+* @param shard the shard returned by shardedHashTable_shard() for this hash
+* @param hash the hash of the key
+* @param key pointer to the key bytes
+* @param key_len number of bytes in the key
+* @return the matching entry, or NULL if there is none.
+*/
+shardedHashEntry* shardedHashTable_lookup(shardedHashTable* cur_table, hashShard* shard, unsigned int hash, const void* key, size_t key_len)
+{
+  shardedHashEntry* curEntry = shard->buckets[hash & (shard->num_buckets - 1)];
+  while(curEntry != NULL)
+  {
+    if(curEntry->hash == hash && cur_table->match(curEntry, key, key_len))
+    {
+      return curEntry;
+    }
+    curEntry = curEntry->next;
+  }
+  return NULL;
+}
+
+/**
+* Doubles the number of buckets in a shard. The caller must hold the shard lock.
+* @param shard the shard to grow
+*/
+void shardedHashTable_grow(hashShard* shard)
+{
+  unsigned int newSize = shard->num_buckets * 2;
+  shardedHashEntry** newBuckets = calloc(newSize, sizeof(shardedHashEntry*));
+  if(newBuckets == NULL)
+  {
+    // Not fatal, the chains just get longer.
+    return;
+  }
+
+  unsigned int i;
+  for(i = 0; i < shard->num_buckets; i++)
+  {
+    shardedHashEntry* curEntry = shard->buckets[i];
+    while(curEntry != NULL)
+    {
+      shardedHashEntry* nextEntry = curEntry->next;
+      unsigned int index = curEntry->hash & (newSize - 1);
+      curEntry->next = newBuckets[index];
+      newBuckets[index] = curEntry;
+      curEntry = nextEntry;
+    }
+  }
+
+  free(shard->buckets);
+  shard->buckets = newBuckets;
+  shard->num_buckets = newSize;
+}
+
+/**
+* Adds an entry to a shard. The caller must hold the shard lock, and must have already checked that the key is not present.
+* @param shard the shard returned by shardedHashTable_shard() for this hash
+* @param entry the caller's entry. entry->hash is filled in here.
+* @param hash the hash of the key
+*/
+void shardedHashTable_insert(hashShard* shard, shardedHashEntry* entry, unsigned int hash)
+{
+  if(shard->num_entries >= shard->num_buckets * SHARDED_HASH_MAX_LOAD)
+  {
+    shardedHashTable_grow(shard);
+  }
+
+  unsigned int index = hash & (shard->num_buckets - 1);
+  entry->hash = hash;
+  entry->next = shard->buckets[index];
+  shard->buckets[index] = entry;
+  shard->num_entries++;
+}
+
+/**
+* Unlinks an entry from a shard. The caller must hold the shard lock, and still owns the entry's memory.
+* @param shard the shard that holds the entry
+* @param entry the entry to remove
+*/
+void shardedHashTable_remove(hashShard* shard, shardedHashEntry* entry)
+{
+  shardedHashEntry** link = &shard->buckets[entry->hash & (shard->num_buckets - 1)];
+  while((*link) != NULL)
+  {
+    //NOTE: comparing addresses!
+    if((*link) == entry)
+    {
+      (*link) = entry->next;
+      entry->next = NULL;
+      shard->num_entries--;
+      return;
+    }
+    link = &(*link)->next;
+  }
+}
@@ -0,0 +1,131 @@
+/**
+* @File slab_allocator.c
+* CS 470 Final Project
+* Implements a fixed size slab of equally sized objects.
+* All the memory is allocated up front in one block, and free objects are kept on an intrusive free list,
+* so allocating and freeing are both O(1) no matter how many objects have come and gone.
+* The thread safe version of each function is suffixed with ts, i.e. slabAllocator_alloc_ts()
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+typedef struct slabFreeObject
+{
+  struct slabFreeObject* next; // Free objects store the free list inside themselves
+} slabFreeObject;
+
+typedef struct
+{
+  char* memory; // One contiguous block holding every object
+  size_t object_size; // Size of one object, rounded up to a cache line
+  unsigned int capacity; // Total number of objects in the slab
+  unsigned int in_use; // Number of objects currently handed out
+  slabFreeObject* free_list;
+  pthread_mutex_t lock;
+} slabAllocator;
+
+/**
+* Creates a new slab
+* @param object_size the size in bytes of one object
+* @param capacity the number of objects the slab can hand out at once
+* @return a pointer to a valid slabAllocator struct for use with the other slabAllocator functions.
+*/
+slabAllocator* slabAllocator_create(size_t object_size, unsigned int capacity)
+{
+  slabAllocator* newSlab;
+  unsigned int i;
+
+  newSlab = malloc(sizeof(slabAllocator));
+  if(newSlab == NULL) { printf("Error allocating memory for slabAllocator"); exit(1); }
+
+  // Round each object up to a whole cache line so neighbouring objects never false-share
+  if(object_size < sizeof(slabFreeObject)) { object_size = sizeof(slabFreeObject); }
+  object_size = (object_size + 63) & ~((size_t)63);
+
+  if(posix_memalign((void**)&newSlab->memory, 64, object_size * capacity) != 0) { printf("Error allocating memory for slabAllocator"); exit(1); }
+
+  newSlab->object_size = object_size;
+  newSlab->capacity = capacity;
+  newSlab->in_use = 0;
+  pthread_mutex_init(&newSlab->lock, NULL);
+
+  // Thread the free list through the block back to front, so the first allocation gets the first object
+  newSlab->free_list = NULL;
+  for(i = capacity; i > 0; i--)
+  {
+    slabFreeObject* curObject = (slabFreeObject*)(newSlab->memory + (object_size * (i - 1)));
+    curObject->next = newSlab->free_list;
+    newSlab->free_list = curObject;
+  }
+
+  return newSlab;
+}
+
+/**
+* Hands out one object from the slab. The contents are not cleared.
+* @param cur_slab a slabAllocator struct
+* @return a pointer to an object, or NULL if every object is in use.
+*/
+void* slabAllocator_alloc(slabAllocator* cur_slab)
+{
+  slabFreeObject* curObject = cur_slab->free_list;
+  if(curObject != NULL)
+  {
+    cur_slab->free_list = curObject->next;
+    cur_slab->in_use++;
+  }
+  return curObject;
+}
+
+void* slabAllocator_alloc_ts(slabAllocator* cur_slab)
+{
+  pthread_mutex_lock(&(cur_slab->lock));
+  void* retVal = slabAllocator_alloc(cur_slab);
+  pthread_mutex_unlock(&(cur_slab->lock));
+  return retVal;
+}
+
+/**
+* Returns an object to the slab.
+* @param cur_slab a slabAllocator struct
+* @param object an object previously returned by slabAllocator_alloc() on this slab
+*/
+void slabAllocator_free(slabAllocator* cur_slab, void* object)
+{
+  slabFreeObject* curObject = (slabFreeObject*)object;
+  curObject->next = cur_slab->free_list;
+  cur_slab->free_list = curObject;
+  cur_slab->in_use--;
+}
+
+void slabAllocator_free_ts(slabAllocator* cur_slab, void* object)
+{
+  pthread_mutex_lock(&(cur_slab->lock));
+  slabAllocator_free(cur_slab, object);
+  pthread_mutex_unlock(&(cur_slab->lock));
+}
+
+/**
+* Finds the position of an object in the slab. Handy as a stable ID for debugging.
+* @param cur_slab a slabAllocator struct
+* @param object an object from this slab
+* @return the index of the object
+*/
+unsigned int slabAllocator_index(slabAllocator* cur_slab, void* object)
+{
+  return (unsigned int)(((char*)object - cur_slab->memory) / cur_slab->object_size);
+}
+
+/**
+* Cleans up a slab. Any objects still handed out become invalid.
+* @param cur_slab A pointer to the slabAllocator to be destroyed
+*/
+void slabAllocator_destroy(slabAllocator* cur_slab)
+{
+  pthread_mutex_destroy(&(cur_slab->lock));
+  free(cur_slab->memory);
+  free(cur_slab);
+}
@@ -0,0 +1,182 @@
+/**
+* @File tracker_connection.c
+* CS 470 Final Project
+* A persistent, pipelined connection to a tracker.
+* Every request and every response on the wire is terminated by a '\0', so one TCP connection can carry any
+* number of them. Responses always come back in the same order the requests went out, so a caller can write a
+* whole window of requests before it reads any of the answers.
+* Requires network_library.c to be included first.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+#define TRACKER_CONNECTION_BUFFER_SIZE 4096
+#define TRACKER_PIPELINE_WINDOW 64 // Most requests to have in flight before reading answers back
+
+typedef struct
+{
+  char trackerName[255];
+  int trackerPort;
+  int sockfd; // -1 while we are not connected
+  char* buffer; // Bytes received from the tracker that have not been handed out yet
+  int bufferSize;
+  int bufferLength;
+  pthread_mutex_t lock; // Held for a whole request/response exchange by trackerConnection_request()
+} trackerConnection;
+
+/**
+* Creates a tracker connection. Nothing is sent until the first request.
+* @param trackerName host name of the tracker
+* @param trackerPort port the tracker listens on
+* @return a pointer to a valid trackerConnection struct for use with the other trackerConnection functions.
+*/
+trackerConnection* trackerConnection_open(const char* trackerName, int trackerPort)
+{
+  trackerConnection* newConnection;
+  newConnection = malloc(sizeof(trackerConnection));
+  if(newConnection == NULL) { printf("Error allocating memory for trackerConnection"); exit(1); }
+
+  strncpy(newConnection->trackerName, trackerName, sizeof(newConnection->trackerName) - 1);
+  newConnection->trackerName[sizeof(newConnection->trackerName) - 1] = '\0';
+  newConnection->trackerPort = trackerPort;
+  newConnection->sockfd = -1;
+  newConnection->bufferSize = TRACKER_CONNECTION_BUFFER_SIZE;
+  newConnection->bufferLength = 0;
+  newConnection->buffer = malloc(newConnection->bufferSize);
+  pthread_mutex_init(&newConnection->lock, NULL);
+
+  return newConnection;
+}
+
+/**
+* Drops the socket. The next request will reconnect.
+* @param cur_connection a trackerConnection struct
+*/
+void trackerConnection_disconnect(trackerConnection* cur_connection)
+{
+  if(cur_connection->sockfd != -1)
+  {
+    close(cur_connection->sockfd);
+    cur_connection->sockfd = -1;
+  }
+  cur_connection->bufferLength = 0;
+}
+
+/**
+* Cleans up a trackerConnection, hanging up on the tracker if we are connected.
+* @param cur_connection A pointer to the trackerConnection to be destroyed
+*/
+void trackerConnection_close(trackerConnection* cur_connection)
+{
+  trackerConnection_disconnect(cur_connection);
+  pthread_mutex_destroy(&cur_connection->lock);
+  free(cur_connection->buffer);
+  free(cur_connection);
+}
+
+/**
+* Sends one request, without waiting for the answer. Connects first if we need to.
+* @param cur_connection a trackerConnection struct
+* @param request a request string, which must not contain a '\0' of its own
+* @return TRUE if the whole request was written
+*/
+int trackerConnection_send(trackerConnection* cur_connection, const char* request)
+{
+  if(cur_connection->sockfd == -1)
+  {
+    cur_connection->sockfd = tcp_connect(cur_connection->trackerName, cur_connection->trackerPort);
+    if(cur_connection->sockfd == -1)
+    {
+      return 0;
+    }
+  }
+
+  // The terminating '\0' is the frame boundary, so it goes out too
+  const char* curByte = request;
+  int remaining = strlen(request) + 1;
+  while(remaining > 0)
+  {
+    int written = send(cur_connection->sockfd, curByte, remaining, MSG_NOSIGNAL);
+    if(written == -1 && errno == EINTR) { continue; }
+    if(written <= 0)
+    {
+      trackerConnection_disconnect(cur_connection);
+      return 0;
+    }
+    curByte += written;
+    remaining -= written;
+  }
+  return 1;
+}
+
+/**
+* Reads the next response off the connection.
+* @param cur_connection a trackerConnection struct
+* @param response buffer to copy the response into. Always NUL terminated, and truncated if it does not fit.
+* @param responseSize size of the response buffer
+* @return the length of the response, or -1 if the connection broke first
+*/
+int trackerConnection_receive(trackerConnection* cur_connection, char* response, int responseSize)
+{
+  char* terminator;
+  while((terminator = memchr(cur_connection->buffer, '\0', cur_connection->bufferLength)) == NULL)
+  {
+    if(cur_connection->sockfd == -1)
+    {
+      return -1;
+    }
+    if(cur_connection->bufferLength == cur_connection->bufferSize)
+    {
+      cur_connection->bufferSize *= 2;
+      cur_connection->buffer = realloc(cur_connection->buffer, cur_connection->bufferSize);
+    }
+    int bytes_read = read(cur_connection->sockfd, cur_connection->buffer + cur_connection->bufferLength, cur_connection->bufferSize - cur_connection->bufferLength);
+    if(bytes_read == -1 && errno == EINTR) { continue; }
+    if(bytes_read <= 0)
+    {
+      trackerConnection_disconnect(cur_connection);
+      return -1;
+    }
+    cur_connection->bufferLength += bytes_read;
+  }
+
+  int frameLength = terminator - cur_connection->buffer;
+  int copyLength = (frameLength < responseSize) ? frameLength : responseSize - 1;
+  memcpy(response, cur_connection->buffer, copyLength);
+  response[copyLength] = '\0';
+
+  // Keep whatever came in behind this response for the next call
+  cur_connection->bufferLength -= (frameLength + 1);
+  memmove(cur_connection->buffer, terminator + 1, cur_connection->bufferLength);
+  return copyLength;
+}
+
+/**
+* Sends one request and waits for its answer. If the tracker dropped our idle connection, reconnects and tries once more.
+* Safe to call from several threads at once.
+* @param cur_connection a trackerConnection struct
+* @param request a request string
+* @param response buffer for the answer
+* @param responseSize size of the response buffer
+* @return the length of the response, or -1 if the tracker could not be reached
+*/
+int trackerConnection_request(trackerConnection* cur_connection, const char* request, char* response, int responseSize)
+{
+  int attempt;
+  int retVal = -1;
+  pthread_mutex_lock(&cur_connection->lock);
+  for(attempt = 0; attempt < 2 && retVal == -1; attempt++)
+  {
+    if(trackerConnection_send(cur_connection, request))
+    {
+      retVal = trackerConnection_receive(cur_connection, response, responseSize);
+    }
+  }
+  pthread_mutex_unlock(&cur_connection->lock);
+  return retVal;
+}
@@ -0,0 +1,205 @@
+/**
+* @File event_loop.c
+* CS 470 Final Project
+* The tracker's non-blocking connection engine. A handful of threads each run their own epoll loop
+* and share the listening socket. Every connection is driven through its own read and write buffers,
+* so a slow client only ever costs us a few hundred bytes of buffer instead of a whole thread.
+* Included by tracker.c, after the connection buffer functions and handle_request().
+*/
+#include <sys/epoll.h>
+
+#define EVENT_LOOP_MAX_EVENTS 256 // How many ready descriptors one epoll_wait() call can hand us
+
+typedef struct {
+	int index; // Which loop this is, useful for debugging
+	int epoll_fd; // This loop's epoll instance
+	int listen_socket; // The shared listening socket
+	pthread_t thread_id; // Thread running this loop
+} event_loop;
+
+/**
+* event_loop_close
+* @param  loop  the event loop that owns this connection
+* @param  me    pointer to this client_struct
+*/
+void event_loop_close(event_loop* loop, client_struct* me)
+{
+	printf("\t[%d]: Connection closed.\n", me->id);
+	epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, me->socket, NULL);
+	close(me->socket);
+	release_slot_buffers(me);
+	release_slot(me);
+}
+
+/**
+* event_loop_accept
+* Accepts every connection waiting on the listening socket and registers it with this loop.
+* @param  loop  the event loop doing the accepting
+*/
+void event_loop_accept(event_loop* loop)
+{
+	while(true)
+	{
+		client_struct* new_client = acquire_slot();
+		if(new_client == NULL)
+		{
+			// Out of connection contexts: take the connection off the backlog and hang up on it
+			int return_status = accept4(loop->listen_socket, NULL, NULL, SOCK_NONBLOCK);
+			if(return_status == -1)
+				return;
+			close(return_status);
+			continue;
+		}
+		initialize_slot(new_client);
+		int return_status = accept4(loop->listen_socket, (struct sockaddr *)&new_client->addr, &new_client->addr_len, SOCK_NONBLOCK);
+		if(return_status == -1)
+		{
+			if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+				printf("ERROR: Failed to accept new connection: %s\n", strerror(errno));
+			release_slot(new_client);
+			return;
+		}
+		new_client->socket = return_status;
+		new_client->loop = loop;
+
+		struct epoll_event event;
+		event.events = EPOLLIN | EPOLLRDHUP;
+		event.data.ptr = new_client;
+		if(epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, new_client->socket, &event) == -1)
+		{
+			printf("ERROR: Failed to watch new connection: %s\n", strerror(errno));
+			close(new_client->socket);
+			release_slot(new_client);
+			continue;
+		}
+		printf("\t[%d]: New connection opened\n", new_client->id);
+	}
+}
+
+/**
+* event_loop_flush
+* Sends what we can, then either closes the connection or asks epoll to tell us when it can take more.
+* @param  loop  the event loop that owns this connection
+* @param  me    pointer to this client_struct
+*/
+void event_loop_flush(event_loop* loop, client_struct* me)
+{
+	int status = connection_flush(me);
+	if(status == -1 || (status == 1 && me->close_after_write))
+	{
+		event_loop_close(loop, me);
+		return;
+	}
+
+	// While responses are backed up, stop reading: a client that pipelines without reading its answers
+	// gets pushed back on by TCP instead of growing our write buffer forever
+	struct epoll_event event;
+	event.events = (status == 0) ? EPOLLOUT : (EPOLLIN | EPOLLRDHUP);
+	event.data.ptr = me;
+	epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, me->socket, &event);
+}
+
+/**
+* event_loop_readable
+* Pulls everything the client has sent into its read buffer and answers every complete request in it.
+* The connection stays open for more requests until the client hangs up.
+* @param  loop  the event loop that owns this connection
+* @param  me    pointer to this client_struct
+*/
+void event_loop_readable(event_loop* loop, client_struct* me)
+{
+	int chars_read;
+
+	// Answer as we go, so a long pipeline never has to fit in the read buffer all at once.
+	// Stop once a batch of answers is waiting, and let the flush decide whether we read more.
+	do
+	{
+		chars_read = connection_read(me);
+		if(chars_read > 0)
+			handle_buffered_requests(me, false);
+	} while(chars_read > 0 && me->write_length < MAX_REQUEST_SIZE);
+
+	if(chars_read == -1)
+	{
+		printf("\t[%d]: recv() error: %s\n", me->id, strerror(errno));
+		event_loop_close(loop, me);
+		return;
+	}
+
+	if(chars_read == 0)
+	{
+		handle_buffered_requests(me, true);
+		me->close_after_write = true;
+	}
+	event_loop_flush(loop, me);
+}
+
+/**
+* event_loop_run
+* @param  loop_in  pointer to this thread's event_loop
+*/
+void* event_loop_run(void* loop_in)
+{
+	event_loop* loop = (event_loop*)loop_in;
+	struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+	int ready, i;
+
+	while(true)
+	{
+		ready = epoll_wait(loop->epoll_fd, events, EVENT_LOOP_MAX_EVENTS, -1);
+		if(ready == -1)
+		{
+			if(errno != EINTR)
+				printf("ERROR: epoll_wait() failed: %s\n", strerror(errno));
+			continue;
+		}
+
+		for(i = 0; i < ready; i++)
+		{
+			client_struct* me = (client_struct*)events[i].data.ptr;
+			// The listening socket is the only thing registered without a client_struct
+			if(me == NULL)
+				event_loop_accept(loop);
+			else if(events[i].events & EPOLLOUT)
+				event_loop_flush(loop, me);
+			else
+				event_loop_readable(loop, me);
+		}
+	}
+	return 0;
+}
+
+/**
+* event_loop_start
+* Spawns the event loop threads. Every loop watches the listening socket with EPOLLEXCLUSIVE,
+* so each new connection wakes just one of them.
+* @param  listen_socket  the socket we are listening on
+* @param  num_loops  how many loop threads to run
+* @return  array of the running loops
+*/
+event_loop* event_loop_start(int listen_socket, int num_loops)
+{
+	event_loop* loops = malloc(sizeof(event_loop) * num_loops);
+	int i;
+
+	set_nonblocking(listen_socket);
+	for(i = 0; i < num_loops; i++)
+	{
+		loops[i].index = i;
+		loops[i].listen_socket = listen_socket;
+		loops[i].epoll_fd = epoll_create1(0);
+		if(loops[i].epoll_fd == -1)
+		{
+			printf("ERROR: epoll_create1() failed: %s\n", strerror(errno));
+			exit(1);
+		}
+
+		struct epoll_event event;
+		event.events = EPOLLIN | EPOLLEXCLUSIVE;
+		event.data.ptr = NULL;
+		epoll_ctl(loops[i].epoll_fd, EPOLL_CTL_ADD, listen_socket, &event);
+
+		pthread_create(&loops[i].thread_id, NULL, event_loop_run, (void*)&loops[i]);
+	}
+	return loops;
+}
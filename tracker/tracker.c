@@ -4,6 +4,7 @@
 * Patrick Anderson
 * This is the tracker program, which coordinates downloads for clients.
 */
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -11,30 +12,50 @@
 #include <errno.h>
 #include <string.h>
 #include <unistd.h>
+#include <signal.h>
+#include <sys/resource.h>
 #include "../lib/network_library.c"
 #include "../lib/random.c"
+#include "../lib/sharded_hash_table.c"
+#include "../lib/slab_allocator.c"
+#include "../lib/bounded_queue.c"
 
 #define true 1
 #define false 0
 #define SR_SEEDERS 1
 #define SR_SUCCESS 0
+#define SR_ERROR 2
 #define STR_LEN 512
 #define MAX_RETURNED_SEEDERS 5
+#define SWARM_SHARDS 64 // Number of independently locked shards in the swarm table
+#define SWARM_SHARD_BUCKETS 64 // Starting bucket count for each shard, grows as the catalogue does
+#define READ_BUFFER_SIZE 256 // Starting size of a connection's read buffer
+#define MAX_REQUEST_SIZE 65536 // A request that grows past this without a terminator gets the connection dropped
+#define MAX_CONNECTIONS 65536 // Default number of connection contexts in the slab
+#define WORKER_POOL_SIZE 64 // Default number of worker threads in threaded mode
+#define WORK_QUEUE_SIZE 1024 // Accepted connections waiting for a worker, before accept() itself waits
 
 typedef struct {
 	int id; // An ID number for this record, useful for debugging
-	pthread_t thread_id;	// Thread ID of this client
 	struct sockaddr_storage addr; // Address information from accept() for this client
 	socklen_t addr_len; // sizeof(addr)
-	int done; // Indicates whether or not this client is still being processed
 	int socket; // Stores the socket descriptor returned by accept()
-	void* next; // Pointer to next node in the list (singly-linked)
 	void* table; // Pointer to the master table
+	void* loop; // The event loop that owns this connection, NULL in threaded mode
+	char* read_buffer; // Bytes received but not yet handled
+	int read_size; // Allocated size of read_buffer
+	int read_length; // Number of valid bytes in read_buffer
+	int scan_offset; // How far into read_buffer we have already looked for a terminator
+	char* write_buffer; // Response bytes waiting to go out
+	int write_size; // Allocated size of write_buffer
+	int write_length; // Number of valid bytes in write_buffer
+	int write_offset; // Number of bytes of write_buffer already sent
+	int close_after_write; // Close the connection as soon as write_buffer drains
 } client_struct;
 
 typedef struct {
+	shardedHashEntry entry; // Must be first, links this swarm into its shard of the master table
 	char hash[STR_LEN];
-	void* next;
 	void* adjacent;
 } hash_node;
 
@@ -45,92 +66,221 @@ typedef struct {
 } seeder_node;
 
 // GLOBAL VARIABLES
-hash_node master_table;
-pthread_mutex_t master_lock = PTHREAD_MUTEX_INITIALIZER;
+shardedHashTable* master_table; // Every swarm, keyed by hash. Each shard carries its own lock.
+slabAllocator* connection_slab; // Every client_struct comes from here, and goes back here when its connection closes
+boundedQueue* work_queue; // Accepted connections waiting for a worker thread (threaded mode only)
+int next_connection_id = 0; // Handed out atomically, since more than one thread can accept
 
-// Debug function for printing the linked list
-void printll(client_struct* s)
+// Debug function for printing the hash table
+void printht(shardedHashTable* table)
 {
-	client_struct* c = s;
-	while(c != NULL)
+	hash_node* h = NULL;
+	seeder_node* s = NULL;
+	unsigned int i, b;
+	
+	for(i = 0; i < table->num_shards; i++)
 	{
-		printf("[%p, %d, %d, %p]\n", c, c->id, c->done, c->next);
-		c = (client_struct*)c->next;
+		hashShard* shard = &table->shards[i];
+		shardedHashTable_lock(shard);
+		for(b = 0; b < shard->num_buckets; b++)
+		{
+			h = (hash_node*)shard->buckets[b];
+			while(h != NULL)
+			{
+				printf("[%s]", h->hash);
+				s = h->adjacent;
+				while(s != NULL)
+				{
+					printf("[%s:%s]", s->host, s->port);
+					s = s->next;
+				}
+				printf("\n");
+				h = (hash_node*)h->entry.next;
+			}
+		}
+		shardedHashTable_unlock(shard);
 	}
 }
 
-// Debug function for printing the hash list
-void printht(hash_node* i)
+// Key comparison for the master table: swarms are keyed by their hash string
+int hash_node_match(shardedHashEntry* entry, const void* key, size_t key_len)
 {
-	hash_node* h = i;
-	seeder_node* s = NULL;
+	hash_node* h = (hash_node*)entry;
+	return strlen(h->hash) == key_len && memcmp(h->hash, key, key_len) == 0;
+}
+
+/**
+* acquire_slot
+* @return  pointer to a free client_struct from the connection slab, or NULL if every one is in use
+*/
+client_struct* acquire_slot()
+{
+	client_struct* slot = (client_struct*)slabAllocator_alloc_ts(connection_slab);
+	if(slot != NULL)
+		slot->id = __sync_fetch_and_add(&next_connection_id, 1);
+	return slot;
+}
+
+/**
+* release_slot
+* @param  slot  pointer to a client_struct whose connection has been closed
+*/
+void release_slot(client_struct* slot)
+{
+	slabAllocator_free_ts(connection_slab, slot);
+}
+
+/**
+* initialize_slot
+* @param  slot  pointer to a client_struct fresh from acquire_slot()
+*/
+void initialize_slot(client_struct* slot)
+{
+	slot->addr_len = sizeof(struct sockaddr_storage);
+	slot->table = master_table;
+	slot->loop = NULL;
+	slot->read_buffer = NULL;
+	slot->read_size = 0;
+	slot->read_length = 0;
+	slot->scan_offset = 0;
+	slot->write_buffer = NULL;
+	slot->write_size = 0;
+	slot->write_length = 0;
+	slot->write_offset = 0;
+	slot->close_after_write = false;
+	memset(&slot->addr, '\0', slot->addr_len);
+}
+
+/**
+* release_slot_buffers
+* @param  slot  pointer to a client_struct whose connection has been closed
+*/
+void release_slot_buffers(client_struct* slot)
+{
+	free(slot->read_buffer);
+	free(slot->write_buffer);
+	slot->read_buffer = NULL;
+	slot->write_buffer = NULL;
+	slot->read_size = slot->read_length = slot->scan_offset = 0;
+	slot->write_size = slot->write_length = slot->write_offset = 0;
+}
+
+/**
+* connection_read
+* Reads whatever is available on the socket into the connection's read buffer, growing it as needed.
+* @param  me  pointer to this client_struct
+* @return     bytes read, 0 on EOF, -1 on error, -2 if a non-blocking socket has nothing for us right now
+*/
+int connection_read(client_struct* me)
+{
+	if(me->read_buffer == NULL)
+	{
+		me->read_size = READ_BUFFER_SIZE;
+		me->read_buffer = malloc(me->read_size);
+	}
+	// Always keep one spare byte so a frame that ends at EOF can still be terminated
+	if(me->read_size - me->read_length < READ_BUFFER_SIZE / 2)
+	{
+		if(me->read_size >= MAX_REQUEST_SIZE)
+			return -1;
+		me->read_size *= 2;
+		me->read_buffer = realloc(me->read_buffer, me->read_size);
+	}
 	
-	while(h != NULL)
+	int chars_read = read(me->socket, me->read_buffer + me->read_length, me->read_size - me->read_length - 1);
+	if(chars_read > 0)
+		me->read_length += chars_read;
+	else if(chars_read == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return -2;
+	else if(chars_read == -1 && errno == EINTR)
+		return -2;
+	return chars_read;
+}
+
+/**
+* connection_next_frame
+* Requests are terminated by a '\0' or a newline. Only the bytes that arrived since the last call are scanned.
+* @param  me  pointer to this client_struct
+* @return     pointer to a NUL-terminated request inside the read buffer, or NULL if no complete request is buffered yet.
+*             The request stays valid until connection_consume_frames() is called.
+*/
+char* connection_next_frame(client_struct* me, int* frame_start)
+{
+	int c;
+	for(c = me->scan_offset; c < me->read_length; c++)
 	{
-		printf("[%s]", h->hash);
-		s = h->adjacent;
-		while(s != NULL)
+		if(me->read_buffer[c] == '\0' || me->read_buffer[c] == '\n')
 		{
-			printf("[%s:%s]", s->host, s->port);
-			s = s->next;
+			char* frame = me->read_buffer + (*frame_start);
+			me->read_buffer[c] = '\0';
+			me->scan_offset = c + 1;
+			(*frame_start) = c + 1;
+			return frame;
 		}
-		printf("\n");
-		h = h->next;
 	}
+	me->scan_offset = me->read_length;
+	return NULL;
 }
 
 /**
-* new_slot
-* @param  schedule  pointer to a client_struct, which should be the first in the linked list of clients
-* @return           pointer to the newly created linked list node
+* connection_consume_frames
+* Throws away every byte before frame_start, keeping any partial request that follows it.
+* @param  me  pointer to this client_struct
+* @param  frame_start  offset of the first byte that has not been handled
 */
-client_struct* new_slot(client_struct* schedule)
+void connection_consume_frames(client_struct* me, int frame_start)
 {
-	client_struct* new_cstruct = malloc(sizeof(client_struct));
-	client_struct* c = schedule;
-	
-	new_cstruct->next = NULL;
-	new_cstruct->id = 0;
-	
-	if(c == NULL)
-		return new_cstruct;
-	
-	while(c->next != NULL)
-		c = (client_struct*)c->next;
-	
-	c->next = new_cstruct;
-	new_cstruct->id = c->id + 1;
-	return new_cstruct;
+	if(frame_start <= 0)
+		return;
+	memmove(me->read_buffer, me->read_buffer + frame_start, me->read_length - frame_start);
+	me->read_length -= frame_start;
+	me->scan_offset -= frame_start;
 }
 
 /**
-* get_next_available_slot
-* @param  schedule  pointer to a client_struct, which should be the first in the linked list of clients
-* @return           pointer to the first available linked list node
+* connection_queue
+* Appends response bytes to the connection's write buffer. Nothing is sent until connection_flush().
+* @param  me  pointer to this client_struct
+* @param  data  bytes to send
+* @param  length  number of bytes to send
 */
-client_struct* get_next_available_slot(client_struct* schedule)
+void connection_queue(client_struct* me, const char* data, int length)
 {
-	client_struct* c = schedule;
-	while(c != NULL)
+	if(me->write_length + length > me->write_size)
 	{
-		if(c->done == true)
-			return c;
-		else
-			c = (client_struct*)c->next;
+		int new_size = (me->write_size == 0) ? READ_BUFFER_SIZE : me->write_size;
+		while(new_size < me->write_length + length)
+			new_size *= 2;
+		me->write_buffer = realloc(me->write_buffer, new_size);
+		me->write_size = new_size;
 	}
-	return new_slot(schedule);
+	memcpy(me->write_buffer + me->write_length, data, length);
+	me->write_length += length;
 }
 
 /**
-* initialize_slot
-* @param  slot  pointer to a client_struct, which should be the first in the linked list of clients
+* connection_flush
+* Writes as much of the write buffer as the socket will take.
+* @param  me  pointer to this client_struct
+* @return     1 if everything was sent, 0 if a non-blocking socket is full, -1 if the connection is broken
 */
-void initialize_slot(client_struct* slot)
+int connection_flush(client_struct* me)
 {
-	slot->addr_len = sizeof(struct sockaddr_storage);
-	slot->done = false;
-	slot->table = &master_table;
-	memset(&slot->addr, '\0', slot->addr_len);
+	while(me->write_offset < me->write_length)
+	{
+		int chars_written = send(me->socket, me->write_buffer + me->write_offset, me->write_length - me->write_offset, MSG_NOSIGNAL);
+		if(chars_written > 0)
+			me->write_offset += chars_written;
+		else if(chars_written == -1 && errno == EINTR)
+			continue;
+		else if(chars_written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return 0;
+		else
+			return -1;
+	}
+	me->write_offset = 0;
+	me->write_length = 0;
+	return 1;
 }
 
 /**
@@ -142,67 +292,53 @@ void initialize_slot(client_struct* slot)
 */
 void add_seeder(client_struct* me, char* host, char* port, char* hash)
 {
-	// LOCK MASTER TABLE
-	pthread_mutex_lock(&master_lock);
+	shardedHashTable* table = (shardedHashTable*)me->table;
+	size_t hash_len = strlen(hash);
+	unsigned int key_hash = shardedHashTable_hash(hash, hash_len);
+	hashShard* shard = shardedHashTable_shard(table, key_hash);
+	
+	// LOCK THE SHARD THIS HASH LIVES IN
+	shardedHashTable_lock(shard);
 	
 	// See if the hash already exists
-	hash_node* c = (hash_node*)me->table;
-	hash_node* last_c = NULL;
-	while(c != NULL)
-	{
-		if(strcmp(c->hash, hash) == 0)
-			break;
-		else
-		{
-			last_c = c;
-			c = c->next;
-		}
-	}
+	hash_node* target = (hash_node*)shardedHashTable_lookup(table, shard, key_hash, hash, hash_len);
 	
-	// If it does not, add a new hash to the end of the list
-	hash_node* target = NULL;
-	if(c == NULL)
+	// If it does not, add a new hash to the table
+	if(target == NULL)
 	{
 		target = malloc(sizeof(hash_node));
-		
-		// This might be the first node in the list
-		if(last_c == NULL)
-			me->table = (void*)target;
-		// Or it might be just a new one
-		else
-			last_c->next = target;
-			
-		target->next = NULL;
 		target->adjacent = NULL;
 		strcpy(target->hash, hash);
+		shardedHashTable_insert(shard, &target->entry, key_hash);
 	}
-	else
-		target = c;
 	
 	// Check if the seeder already exists (if he does, end the function - we don't need to add somebody who's already here)
 	seeder_node* d = target->adjacent;
-	if(d != NULL)
-		while(d->next != NULL)
+	seeder_node* last_d = NULL;
+	while(d != NULL)
+	{
+		if(strcmp(d->host, host) == 0 && strcmp(d->port, port) == 0)
 		{
-			if(strcmp(d->host, host) == 0 && strcmp(d->port, port) == 0)
-				return;
-			else
-				d = d->next;
+			shardedHashTable_unlock(shard);
+			return;
 		}
+		last_d = d;
+		d = d->next;
+	}
 		
 	// Add the new guy
 	seeder_node* new_seeder = malloc(sizeof(seeder_node));
 	strcpy(new_seeder->host, host);
 	strcpy(new_seeder->port, port);
 	
-	if(d == NULL)
+	if(last_d == NULL)
 		target->adjacent = new_seeder;
 	else
-		d->next = new_seeder;
+		last_d->next = new_seeder;
 	new_seeder->next = NULL;
 	
-	// UNLOCK MASTER TABLE
-	pthread_mutex_unlock(&master_lock);
+	// UNLOCK THE SHARD
+	shardedHashTable_unlock(shard);
 	
 	printf("\t[%d]: Adding seeder: (%s:%s, %s)\n", me->id, host, port, hash);
 }
@@ -214,58 +350,65 @@ void add_seeder(client_struct* me, char* host, char* port, char* hash)
 */
 void remove_seeder(client_struct* me, char* host, char* port)
 {	
-	// LOCK MASTER TABLE
-	pthread_mutex_lock(&master_lock);
-	
-	hash_node* h = me->table;
+	shardedHashTable* table = (shardedHashTable*)me->table;
+	hash_node* h = NULL;
 	seeder_node* s = NULL;
 	seeder_node* last_s = NULL;
 	seeder_node* temp = NULL;
+	unsigned int i, b;
 	
-	while(h != NULL)
+	// A host can be in any swarm, so visit every shard - but only ever hold one shard lock at a time
+	for(i = 0; i < table->num_shards; i++)
 	{
-		s = h->adjacent;
-		last_s = NULL;
-		while(s != NULL)
+		hashShard* shard = &table->shards[i];
+		shardedHashTable_lock(shard);
+		for(b = 0; b < shard->num_buckets; b++)
 		{
-			if(strcmp(s->host, host) == 0 && strcmp(s->port, port) == 0)
+			h = (hash_node*)shard->buckets[b];
+			while(h != NULL)
 			{
-				// This is the first host in the list
-				if(last_s == NULL)
-				{
-					h->adjacent = s->next;
-					temp = s->next;
-					free(s);
-					s = temp;
-				}
-				// This is one of the other hosts
-				else
+				s = h->adjacent;
+				last_s = NULL;
+				while(s != NULL)
 				{
-					last_s->next = s->next;
-					temp = s->next;
-					free(s);
-					s = temp;
+					if(strcmp(s->host, host) == 0 && strcmp(s->port, port) == 0)
+					{
+						// This is the first host in the list
+						if(last_s == NULL)
+						{
+							h->adjacent = s->next;
+							temp = s->next;
+							free(s);
+							s = temp;
+						}
+						// This is one of the other hosts
+						else
+						{
+							last_s->next = s->next;
+							temp = s->next;
+							free(s);
+							s = temp;
+						}
+					}
+					else
+					{
+						last_s = s;
+						s = s->next;
+					}
 				}
-			}
-			else
-			{
-				last_s = s;
-				s = s->next;
+				h = (hash_node*)h->entry.next;
 			}
 		}
-		h = h->next;
+		shardedHashTable_unlock(shard);
 	}
 	
-	// UNLOCK MASTER TABLE
-	pthread_mutex_unlock(&master_lock);
-	
 	printf("\t[%d]: Removing seeder: (%s:%s)\n", me->id, host, port);
 }
 
 /**
  send_response
  @param	 me  this client's client_struct
- @param  sr_mode  can be SR_SUCCESS (we just send success) or SR_SEEDERS (we send a list of 5 or less seeders)
+ @param  sr_mode  can be SR_SUCCESS (we just send success), SR_ERROR (we couldn't understand the request) or SR_SEEDERS (we send a list of 5 or less seeders)
  @param  hash  the hash/filename
 */
 void send_response(client_struct* me, int sr_mode, char* hash)
@@ -274,100 +417,98 @@ void send_response(client_struct* me, int sr_mode, char* hash)
 	{
 		char msg[8];
 		strcpy(msg, "SUCCESS");
-		write(me->socket, msg, sizeof(msg));
+		connection_queue(me, msg, sizeof(msg));
+		printf("\t[%d]: Sent: '%s'\n", me->id, msg);
+	}
+	else if(sr_mode == SR_ERROR)
+	{
+		// Every request gets exactly one answer, even a bad one, or pipelined responses would slip out of step
+		char msg[6];
+		strcpy(msg, "ERROR");
+		connection_queue(me, msg, sizeof(msg));
 		printf("\t[%d]: Sent: '%s'\n", me->id, msg);
 	}
 	else if(sr_mode == SR_SEEDERS)
 	{
-		char seeder_hosts[5][STR_LEN];
-		char seeder_ports[5][6];
+		shardedHashTable* table = (shardedHashTable*)me->table;
+		size_t hash_len = strlen(hash);
+		unsigned int key_hash = shardedHashTable_hash(hash, hash_len);
+		hashShard* shard = shardedHashTable_shard(table, key_hash);
 		int  seeder_count = 0;
+		char msg[2048]; memset(msg, '\0', sizeof(msg));
+		
+		// Build the response while holding the shard lock, so nobody frees a seeder out from under us,
+		// but don't hold it across the write - a slow client shouldn't stall everyone else in this shard.
+		shardedHashTable_lock(shard);
+		hash_node* h = (hash_node*)shardedHashTable_lookup(table, shard, key_hash, hash, hash_len);
+		seeder_node* s = (h != NULL) ? h->adjacent : NULL;
 		
-		hash_node* h = me->table;
-		seeder_node* s = NULL;
-		while(h != NULL)
+		// If any seeders exist
+		if(s != NULL)
 		{
-			if(strcmp(h->hash, hash) == 0)
+			// Run through once to get the count
+			while(s != NULL)
 			{
+				seeder_count++;
+				s = s->next;
+			}
+			
+			// If there are less than MAX_RETURNED_SEEDERS, send them all
+			if(seeder_count <= MAX_RETURNED_SEEDERS)
+			{
+				char seeder_count_str[64]; memset(seeder_count_str, '\0', sizeof(seeder_count_str));
+				sprintf(seeder_count_str, "%d", seeder_count);
+				strcpy(msg, "SEEDERS/");
+				strcat(msg, hash);
+				strcat(msg, "/");
+				strcat(msg, seeder_count_str);
+				
 				s = h->adjacent;
+				while(s != NULL)
+				{
+					strcat(msg, "/");
+					strcat(msg, s->host);
+					strcat(msg, ":");
+					strcat(msg, s->port);
+					s = s->next;
+				}
+			}
+			// Otherwise, pick random ones and send them
+			else
+			{
+				srand(time(NULL));
+				int skips = MAX_RETURNED_SEEDERS - seeder_count;
+				
+				sprintf(msg, "SEEDERS/%s/%d", hash, MAX_RETURNED_SEEDERS);
 				
-				// If any seeders exist
-				if(s != NULL)
+				s = h->adjacent;
+				while(s != NULL)
 				{
-					// Run through once to get the count
-					while(s != NULL)
+					if((rand() & 1) == 0 && skips > 0)
 					{
-						seeder_count++;
-						s = s->next;
+						skips--;
+						continue;
 					}
 					
-					// If there are less than MAX_RETURNED_SEEDERS, send them all
-					if(seeder_count <= MAX_RETURNED_SEEDERS)
-					{
-						char msg[2048]; memset(msg, '\0', sizeof(msg));
-						char seeder_count_str[64]; memset(seeder_count_str, '\0', sizeof(seeder_count_str));
-						sprintf(seeder_count_str, "%d", seeder_count);
-						strcpy(msg, "SEEDERS/");
-						strcat(msg, hash);
-						strcat(msg, "/");
-						strcat(msg, seeder_count_str);
-						
-						s = h->adjacent;
-						while(s != NULL)
-						{
-							strcat(msg, "/");
-							strcat(msg, s->host);
-							strcat(msg, ":");
-							strcat(msg, s->port);
-							s = s->next;
-						}
-						
-						write(me->socket, msg, sizeof(msg));
-						printf("\t[%d]: Sent: '%s'\n", me->id, msg);
-					}
-					// Otherwise, pick random ones and send them
-					else
-					{
-						srand(time(NULL));
-						int skips = MAX_RETURNED_SEEDERS - seeder_count;
-						char msg[2048]; memset(msg, '\0', sizeof(msg));
-						
-						sprintf(msg, "SEEDERS/%s/%d", hash, MAX_RETURNED_SEEDERS);
-						
-						s = h->adjacent;
-						while(s != NULL)
-						{
-							if((rand() & 1) == 0 && skips > 0)
-							{
-								skips--;
-								continue;
-							}
-							
-							strcat(msg, "/");
-							strcat(msg, s->host);
-							strcat(msg, ":");
-							strcat(msg, s->port);
-							s = s->next;
-						}
-						write(me->socket, msg, sizeof(msg));
-						printf("\t[%d]: Sent: '%s'\n", me->id, msg);
-					}
+					strcat(msg, "/");
+					strcat(msg, s->host);
+					strcat(msg, ":");
+					strcat(msg, s->port);
+					s = s->next;
 				}
-				// Otherwise...
-				else
-				{
-					seeder_count = 0;
-					char msg[8 + strlen(hash) + 2];
-					strcpy(msg, "SEEDERS/");
-					strcat(msg, hash);
-					strcat(msg, "/0");
-					write(me->socket, msg, sizeof(msg));
-					printf("\t[%d]: Sent: '%s'\n", me->id, msg);
-				}
-				break;
 			}
-			h = h->next;
 		}
+		// Otherwise...
+		else
+		{
+			strcpy(msg, "SEEDERS/");
+			strcat(msg, hash);
+			strcat(msg, "/0");
+		}
+		shardedHashTable_unlock(shard);
+		
+		connection_queue(me, msg, strlen(msg) + 1);
+		printf("\t[%d]: Sent: '%s'\n", me->id, msg);
 	}
 	else
 		printf("ERROR: invalid value for sr_mode\n");
@@ -388,7 +529,12 @@ void handle_request(client_struct* me, char* input_string)
 	printf("\t[%d]: Received: '%s'\n", me->id, input_string);
 	word = strtok_r(input_string, "/", &r[0]);
 	
-	if(strcmp(word, "STARTED") == 0)
+	if(word == NULL)
+	{
+		printf("ERROR: Received misformed request\n");
+		send_response(me, SR_ERROR, NULL);
+	}
+	else if(strcmp(word, "STARTED") == 0)
 	{
 		word = strtok_r(NULL, "/", &r[0]);
 		host = strtok_r(word, ":", &r[1]);
@@ -405,6 +551,7 @@ void handle_request(client_struct* me, char* input_string)
 		port = strtok_r(NULL, ":", &r[1]);
 		// Remove the guy from the list of seeders
 		remove_seeder(me, host, port);
+		send_response(me, SR_SUCCESS, NULL);
 	}
 	else if(strcmp(word, "NEEDY") == 0)
 	{
@@ -426,11 +573,51 @@ void handle_request(client_struct* me, char* input_string)
 		add_seeder(me, host, port, hash);
 	}
 	else
+	{
 		printf("ERROR: Received misformed request\n");
+		send_response(me, SR_ERROR, NULL);
+	}
+}
+
+/**
+* handle_buffered_requests
+* Handles every complete request sitting in the connection's read buffer, in order. Their responses are
+* queued in the same order, so a client can pipeline as many requests as it likes on one connection.
+* @param  me  pointer to this client_struct
+* @param  at_eof  true if the client has hung up, in which case a trailing unterminated request is handled too
+* @return     number of requests handled
+*/
+int handle_buffered_requests(client_struct* me, int at_eof)
+{
+	int frame_start = 0;
+	int handled = 0;
+	char* request;
+	
+	while((request = connection_next_frame(me, &frame_start)) != NULL)
+	{
+		if(request[0] != '\0')
+		{
+			handle_request(me, request);
+			handled++;
+		}
+	}
+	
+	// A client that hangs up without a terminator still gets what it sent handled
+	if(at_eof && frame_start < me->read_length)
+	{
+		me->read_buffer[me->read_length] = '\0';
+		handle_request(me, me->read_buffer + frame_start);
+		frame_start = me->read_length;
+		handled++;
+	}
+	
+	connection_consume_frames(me, frame_start);
+	return handled;
 }
 
 /**
 * process_request
+* Threaded mode: blocks on this one client, answering every request it sends until it hangs up.
 * @param  cstruct_in  pointer to a client_struct
 */
 void* process_request(void* cstruct_in)
@@ -439,40 +626,42 @@ void* process_request(void* cstruct_in)
 	printf("\t[%d]: New connection opened\n", me->id);
 	
 	// REQUEST PROCESSING CODE
-	// We just make a buffer and read into it until we see a newline
+	// Read into the connection's buffer, and answer requests as they complete
 	int chars_read = -1;
-	int buffer_size = 256;
-	int read_offset = 0;
-	char* read_buffer = malloc(buffer_size);
-	
-	memset(read_buffer, '\0', buffer_size);
 	
-	// Get the request
 	do
 	{
-		if((double)(buffer_size - read_offset) < (double)((double)buffer_size * 0.5))
-		{
-			read_buffer = realloc(read_buffer, buffer_size*2);
-			buffer_size = buffer_size*2;
-		}
-		chars_read = read(me->socket, read_buffer + read_offset, buffer_size - read_offset);
-		read_offset += chars_read;
-	} while(chars_read > 0 && !memchr(read_buffer, '\0', buffer_size));
-	if(chars_read == -1)
-		printf("\t[%d]: recv() error: %s\n", me->id, strerror(errno));	
-	//str_trim(read_buffer);
-	
-	// Evaluate and handle the request
-	handle_request(me, read_buffer);
+		chars_read = connection_read(me);
+		if(chars_read == -1)
+			printf("\t[%d]: recv() error: %s\n", me->id, strerror(errno));
+		handle_buffered_requests(me, chars_read <= 0);
+		if(connection_flush(me) == -1)
+			break;
+	} while(chars_read > 0);
 	
 	// Close connection
 	//printht(me->table);
 	printf("\t[%d]: Connection closed.\n", me->id);
 	close(me->socket);
-	me->done = true;
+	release_slot_buffers(me);
+	release_slot(me);
+	return 0;
+}
+
+/**
+* worker_thread
+* Threaded mode: one of a fixed pool of threads that take accepted connections off the work queue.
+* @param  arg  unused
+*/
+void* worker_thread(void* arg)
+{
+	while(true)
+		process_request(boundedQueue_pop(work_queue));
 	return 0;
 }
 
+#include "event_loop.c"
+
 /**
 * Main
 * @param  argc	number of arguments
@@ -485,36 +674,92 @@ int main(int argc, char* argv[])
 	int		port = 0;		// Stores the port we're running on
 	int		main_socket = 0;	// Stores the socket we're listening on
 	int		return_status = 0;	// Used to check the return status of various statements
-	client_struct* 	new_client = NULL;	// Stores a pointer to our new client in the linked list of clients
-	client_struct*	schedule = NULL;	// Stores a pointer to the linked list of clients
+	int		threaded_mode = false;	// Use a pool of blocking worker threads instead of event loops
+	int		num_threads = 0;	// How many event loops or worker threads to run
+	int		max_connections = MAX_CONNECTIONS;	// How many connections we will hold open at once
+	int		option;
+	client_struct* 	new_client = NULL;	// Stores a pointer to our new client
+	pthread_t	worker_id;
 	
-	// Get the port name from command line arguments
-	if(argc != 2)
+	// Get the options and port name from command line arguments
+	while((option = getopt(argc, argv, "m:t:c:")) != -1)
 	{
-		printf("Usage: ./tracker <port>\n");
+		if(option == 'm' && strcmp(optarg, "threads") == 0)
+			threaded_mode = true;
+		else if(option == 'm' && strcmp(optarg, "epoll") == 0)
+			threaded_mode = false;
+		else if(option == 't')
+			num_threads = str_to_int(optarg);
+		else if(option == 'c')
+			max_connections = str_to_int(optarg);
+		else
+			optind = argc + 1;
+	}
+	if(optind != argc - 1 || num_threads < 0 || max_connections < 1)
+	{
+		printf("Usage: ./tracker [-m epoll|threads] [-t threads] [-c max_connections] <port>\n");
 		return -1;
 	}
-	port = str_to_int(argv[1]);
+	port = str_to_int(argv[optind]);
+	if(num_threads == 0)
+		num_threads = threaded_mode ? WORKER_POOL_SIZE : sysconf(_SC_NPROCESSORS_ONLN);
+	
+	// A client hanging up mid-response must not take the whole tracker down with it
+	signal(SIGPIPE, SIG_IGN);
+	
+	// Every connection is a descriptor, so let ourselves have as many as the system allows
+	struct rlimit fd_limit;
+	if(getrlimit(RLIMIT_NOFILE, &fd_limit) == 0)
+	{
+		fd_limit.rlim_cur = fd_limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &fd_limit);
+	}
+	
+	// Set up the swarm table and the connection contexts
+	master_table = shardedHashTable_create(SWARM_SHARDS, SWARM_SHARD_BUCKETS, hash_node_match);
+	connection_slab = slabAllocator_create(sizeof(client_struct), max_connections);
 	
 	// Set up socket to listen on
 	main_socket = tcp_listen(port);
 	
-	// Loop and accept connections, create threads to handle requests
+	// Hand the listening socket to the event loops, and let them do all the work
+	if(!threaded_mode)
+	{
+		event_loop* loops = event_loop_start(main_socket, num_threads);
+		printf("[MAIN]: Running %d event loops\n", num_threads);
+		pthread_join(loops[0].thread_id, NULL);
+		return 0;
+	}
+	
+	// Start the worker pool
+	work_queue = boundedQueue_create(WORK_QUEUE_SIZE);
+	for(return_status = 0; return_status < num_threads; return_status++)
+		pthread_create(&worker_id, NULL, worker_thread, NULL);
+	printf("[MAIN]: Running %d worker threads\n", num_threads);
+	
+	// Loop and accept connections, queue them up for the workers
 	while(true)
 	{
-		new_client = get_next_available_slot(schedule);
-		if(schedule == NULL)
-			schedule = new_client;
+		new_client = acquire_slot();
+		if(new_client == NULL)
+		{
+			// Out of connection contexts: take the connection off the backlog and hang up on it
+			return_status = accept(main_socket, NULL, NULL);
+			if(return_status != -1)
+				close(return_status);
+			continue;
+		}
 		initialize_slot(new_client);
 		return_status = accept(main_socket, (struct sockaddr *)&new_client->addr, &new_client->addr_len);
 		if(return_status == -1)
 		{
 			printf("ERROR: Failed to accept new connection: %s", strerror(errno));
+			release_slot(new_client);
 			continue;
 		}
 		new_client->socket = return_status;
-		printf("[MAIN]: Launching %d\n", new_client->id);
-		pthread_create(&new_client->thread_id, NULL, process_request, (void*)new_client);
+		printf("[MAIN]: Queueing %d\n", new_client->id);
+		boundedQueue_push(work_queue, new_client);
 	}
 	return 0;
 }